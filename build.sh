@@ -2,6 +2,28 @@
 
 set -xeu
 
-files="src/main.c src/Utils.c"
+# CHAIN_LIBRARY=1 builds the chain evaluators into libchain.so and
+# links both programs against it instead of compiling them in.
+chain_library=${CHAIN_LIBRARY:-0}
 
-cc -Wall -Wextra -pedantic -g ${files} -lglfw -lGL -lGLEW -lm
+flags="-Wall -Wextra -pedantic -g"
+chain="chain.o"
+chain_libs=""
+
+# The chain evaluators rely on the compiler to unroll them, so they
+# are built with optimizations even when the viewer is not.
+if [ "${chain_library}" = 1 ]; then
+  cc ${flags} -O2 -fPIC -shared src/Chain.c -o libchain.so -lm
+  chain=""
+  chain_libs="-L. -lchain -Wl,-rpath,\$ORIGIN"
+else
+  cc ${flags} -O2 -c src/Chain.c -o chain.o
+fi
+
+files="src/main.c src/Utils.c src/Shader.c src/Fourier.c ${chain}"
+batch_files="src/batch.c src/Utils.c src/Fourier.c ${chain}"
+bench_files="src/bench.c src/Utils.c ${chain}"
+
+cc ${flags} ${files} ${chain_libs} -lglfw -lGL -lGLEW -lm -lpthread
+cc ${flags} -O2 ${batch_files} -o batch ${chain_libs} -lm -lpthread
+cc ${flags} -O2 ${bench_files} -o bench ${chain_libs} -lm -lpthread
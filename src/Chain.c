@@ -0,0 +1,114 @@
+#include <math.h>
+
+#include "Chain.h"
+
+int32_t
+get_frequency (size_t index)
+{
+  return index % 2 == 1 ? -(int32_t)((index + 1) / 2)
+                        : (int32_t)(index / 2);
+}
+
+// Same stepped rotation as the unrolled evaluators below, but for any
+// number of coefficients, including chains that end on a negative
+// frequency.
+void
+evaluate_chain_generic (float *dst, size_t stride,
+                        const Arrayf *coeffs, float t)
+{
+  float const step_c = cos (t), step_s = sin (t);
+  float c = 1, s = 0;
+  float x = coeffs->data[0], y = coeffs->data[1];
+
+  dst[0] = x;
+  dst[1] = y;
+
+  for (size_t i = 1; i < coeffs->count; i++)
+    {
+      float const *const coeff = coeffs->data + 2 * i;
+
+      // Odd indices start the next absolute frequency, whose negative
+      // comes first and turns the other way.
+      if (i % 2 == 1)
+        {
+          float const next_c = c * step_c - s * step_s;
+          s = c * step_s + s * step_c;
+          c = next_c;
+
+          x += coeff[0] * c + coeff[1] * s;
+          y += coeff[1] * c - coeff[0] * s;
+        }
+      else
+        {
+          x += coeff[0] * c - coeff[1] * s;
+          y += coeff[0] * s + coeff[1] * c;
+        }
+
+      dst[stride * i + 0] = x;
+      dst[stride * i + 1] = y;
+    }
+}
+
+// Frequencies "-k" and "k" share one rotation, which is stepped from
+// "k - 1" by a complex multiplication, so there is a single sin/cos
+// pair per call and no branches on the frequency.
+#define DEFINE_CHAIN_EVALUATOR(DEGREE)                                  \
+  void                                                                  \
+  evaluate_chain_##DEGREE (float *dst, size_t stride,                   \
+                           const float *coeffs, float t)                \
+  {                                                                     \
+    float const step_c = cos (t), step_s = sin (t);                     \
+    float c = 1, s = 0;                                                 \
+    float x = coeffs[0], y = coeffs[1];                                 \
+                                                                        \
+    dst[0] = x;                                                         \
+    dst[1] = y;                                                         \
+                                                                        \
+    _Pragma ("GCC unroll 64")                                           \
+    for (size_t k = 1; k <= DEGREE; k++)                                \
+      {                                                                 \
+        float const next_c = c * step_c - s * step_s;                   \
+        s = c * step_s + s * step_c;                                    \
+        c = next_c;                                                     \
+                                                                        \
+        float const *const neg = coeffs + 2 * (2 * k - 1);              \
+        x += neg[0] * c + neg[1] * s;                                   \
+        y += neg[1] * c - neg[0] * s;                                   \
+        dst[stride * (2 * k - 1) + 0] = x;                              \
+        dst[stride * (2 * k - 1) + 1] = y;                              \
+                                                                        \
+        float const *const pos = coeffs + 2 * (2 * k);                  \
+        x += pos[0] * c - pos[1] * s;                                   \
+        y += pos[0] * s + pos[1] * c;                                   \
+        dst[stride * (2 * k) + 0] = x;                                  \
+        dst[stride * (2 * k) + 1] = y;                                  \
+      }                                                                 \
+  }
+
+DEFINE_CHAIN_EVALUATOR (8)
+DEFINE_CHAIN_EVALUATOR (16)
+DEFINE_CHAIN_EVALUATOR (32)
+DEFINE_CHAIN_EVALUATOR (64)
+
+void
+evaluate_chain (float *dst, size_t stride, const Arrayf *coeffs, float t)
+{
+  switch (coeffs->count)
+    {
+    case 2 * 8 + 1:
+      evaluate_chain_8 (dst, stride, coeffs->data, t);
+      break;
+    case 2 * 16 + 1:
+      evaluate_chain_16 (dst, stride, coeffs->data, t);
+      break;
+    case 2 * 32 + 1:
+      evaluate_chain_32 (dst, stride, coeffs->data, t);
+      break;
+    case 2 * 64 + 1:
+      evaluate_chain_64 (dst, stride, coeffs->data, t);
+      break;
+    default:
+      evaluate_chain_generic (dst, stride, coeffs, t);
+      break;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef CHAIN_H
+#define CHAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Utils.h"
+
+// Coefficients are kept in the order of the chain, sorted by absolute
+// frequency: "0, -1, 1, -2, 2, ...". Raising the degree only appends.
+int32_t
+get_frequency (size_t index);
+
+// Writes the center of every circle in the chain at time "t" into
+// "dst", "stride" floats apart. Degrees 8, 16, 32 and 64 go through
+// unrolled evaluators, others through "evaluate_chain_generic".
+void
+evaluate_chain (float *dst, size_t stride, const Arrayf *coeffs, float t);
+
+void
+evaluate_chain_generic (float *dst, size_t stride,
+                        const Arrayf *coeffs, float t);
+
+void
+evaluate_chain_8 (float *dst, size_t stride, const float *coeffs, float t);
+
+void
+evaluate_chain_16 (float *dst, size_t stride, const float *coeffs, float t);
+
+void
+evaluate_chain_32 (float *dst, size_t stride, const float *coeffs, float t);
+
+void
+evaluate_chain_64 (float *dst, size_t stride, const float *coeffs, float t);
+
+#endif // CHAIN_H
@@ -0,0 +1,269 @@
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "Fourier.h"
+
+typedef struct Vec2f Vec2f;
+
+struct Vec2f
+{
+  float x, y;
+};
+
+void
+acc_scale_v2f (Vec2f *dst, Vec2f s, Vec2f x, Vec2f y)
+{
+  dst->x += s.x * x.x + s.y * y.x;
+  dst->y += s.x * x.y + s.y * y.y;
+}
+
+Vec2f
+integrant (float *z, float angle)
+{
+  float x = z[0], y = z[1];
+  float c = cos (angle), s = sin (angle);
+
+  // Compute "z * e^(-i * angle)".
+  return (Vec2f){ x * c + y * s, y * c - x * s };
+}
+
+void
+compute_fourier_coeffs (float *dst, float *z, size_t count,
+                        size_t begin, size_t end)
+{
+  assert (count % 2 == 1);
+
+  --count;
+
+  float const dt = 2.0 * M_PI / count;
+  float const factor = (1.0 / 3.0) / count;
+
+  for (size_t ind = begin; ind < end; ind++)
+    {
+      int32_t const i = get_frequency (ind);
+
+      Vec2f coeff = { 0, 0 };
+
+      acc_scale_v2f (&coeff,
+                     (Vec2f){ factor, -factor },
+                     integrant (z + 0, 0),
+                     integrant (z + 3 * count, i * dt * count));
+
+      for (size_t j = 1; j < count; j += 2)
+        {
+          acc_scale_v2f (&coeff,
+                         (Vec2f){ 4 * factor, 2 * factor },
+                         integrant (z + 3 * j, i * dt * j),
+                         integrant (z + 3 * (j + 1), i * dt * (j + 1)));
+        }
+
+      dst[2 * ind + 0] = coeff.x;
+      dst[2 * ind + 1] = coeff.y;
+    }
+}
+
+void
+compute_fourier_series (float *dst, float *z, size_t count,
+                        uint32_t degree)
+{
+  compute_fourier_coeffs (dst, z, count, 0, 2 * degree + 1);
+}
+
+// Places "count" points evenly by arc length along the closed polygon
+// "path", the last one coinciding with the first. The result has
+// three components per point, as "compute_fourier_series" expects.
+void
+resample_closed_path (Arrayf *dst, const Arrayf *path, size_t count)
+{
+  assert (dst->comps == 3 && dst->capacity >= count && count > 1);
+  assert (path->count > 0);
+
+  size_t const comps = path->comps;
+  size_t const n = path->count;
+
+  float length = 0;
+
+  for (size_t i = 0; i < n; i++)
+    {
+      float const *a = path->data + comps * i;
+      float const *b = path->data + comps * ((i + 1) % n);
+
+      length += hypot (b[0] - a[0], b[1] - a[1]);
+    }
+
+  float const step = length / (count - 1);
+
+  size_t seg = 0;
+  float seg_start = 0;
+
+  for (size_t k = 0; k < count; k++)
+    {
+      float const s = k * step;
+      float const *a, *b;
+      float seg_length;
+
+      while (true)
+        {
+          a = path->data + comps * seg;
+          b = path->data + comps * ((seg + 1) % n);
+          seg_length = hypot (b[0] - a[0], b[1] - a[1]);
+
+          if (s <= seg_start + seg_length || seg + 1 >= n)
+            break;
+
+          seg_start += seg_length;
+          ++seg;
+        }
+
+      float w = seg_length > 0 ? (s - seg_start) / seg_length : 0;
+      w = w < 0 ? 0 : (w > 1 ? 1 : w);
+
+      float *const point = dst->data + 3 * k;
+      point[0] = a[0] + w * (b[0] - a[0]);
+      point[1] = a[1] + w * (b[1] - a[1]);
+      point[2] = 0;
+    }
+
+  dst->count = count;
+}
+
+// Adds the contribution of chain coefficient "ind" to the
+// reconstruction "recon" at "count" evenly spaced times over one
+// period. The rotation is stepped by complex multiplication rather
+// than evaluated per sample.
+void
+accumulate_reconstruction (float *recon, size_t count,
+                           const Arrayf *coeffs, size_t ind)
+{
+  int32_t const freq = get_frequency (ind);
+  double const angle = 2.0 * M_PI / count * freq;
+  double const step_c = cos (angle), step_s = sin (angle);
+
+  double x = coeffs->data[2 * ind + 0];
+  double y = coeffs->data[2 * ind + 1];
+
+  for (size_t j = 0; j < count; j++)
+    {
+      recon[2 * j + 0] += x;
+      recon[2 * j + 1] += y;
+
+      double next_x = x * step_c - y * step_s;
+      y = x * step_s + y * step_c;
+      x = next_x;
+    }
+}
+
+FitError
+measure_fit_error (const float *recon, const Arrayf *samples)
+{
+  size_t const count = samples->count - 1;
+
+  FitError error = { 0, 0 };
+
+  for (size_t j = 0; j < count; j++)
+    {
+      float const *z = samples->data + samples->comps * j;
+      float const dist = hypot (recon[2 * j + 0] - z[0],
+                                recon[2 * j + 1] - z[1]);
+
+      if (dist > error.max)
+        error.max = dist;
+
+      error.rms += dist * dist;
+    }
+
+  error.rms = sqrt (error.rms / count);
+
+  return error;
+}
+
+// Compares the chain against the curve "samples" it was fit to, which
+// spans one period including the end point.
+FitError
+compute_fit_error (Arena *scratch, const Arrayf *coeffs,
+                   const Arrayf *samples)
+{
+  size_t const mark = get_arena_mark (scratch);
+  size_t const count = samples->count - 1;
+
+  float *recon = allocate_in_arena (scratch, 2 * count * sizeof (float));
+  memset (recon, 0, 2 * count * sizeof (float));
+
+  for (size_t i = 0; i < coeffs->count; i++)
+    accumulate_reconstruction (recon, count, coeffs, i);
+
+  FitError error = measure_fit_error (recon, samples);
+
+  restore_arena (scratch, mark);
+
+  return error;
+}
+
+uint32_t
+fit_fourier_series (Arena *scratch, Arrayf *coeffs, Arrayf *samples,
+                    uint32_t max_degree, FitNorm norm, float tolerance)
+{
+  assert (coeffs->capacity >= 2 * max_degree + 1);
+
+  size_t const mark = get_arena_mark (scratch);
+  size_t const count = samples->count - 1;
+
+  // Past half the number of intervals frequencies alias onto lower
+  // ones, so they can only make the fit worse between samples.
+  if (max_degree > count / 2)
+    max_degree = count / 2;
+
+  float *recon = allocate_in_arena (scratch, 2 * count * sizeof (float));
+  memset (recon, 0, 2 * count * sizeof (float));
+
+  uint32_t degree = 0, best_degree = 0;
+  float best_error = INFINITY;
+
+  compute_fourier_coeffs (coeffs->data,
+                          samples->data,
+                          samples->count,
+                          0,
+                          1);
+  accumulate_reconstruction (recon, count, coeffs, 0);
+
+  for (;;)
+    {
+      FitError const fit = measure_fit_error (recon, samples);
+      float const error = norm == FIT_MAX ? fit.max : fit.rms;
+
+      if (error < best_error)
+        {
+          best_error = error;
+          best_degree = degree;
+        }
+
+      // The error may stall for many degrees, e.g. a shape with k-fold
+      // symmetry only has frequencies "1 + m * k", so every degree up
+      // to the cap is tried before settling for the smallest error.
+      if (error <= tolerance || degree >= max_degree)
+        break;
+
+      // Lower frequencies are already in place, only the two new ones
+      // are computed and added to the reconstruction.
+      size_t const begin = 2 * degree + 1;
+
+      ++degree;
+
+      compute_fourier_coeffs (coeffs->data,
+                              samples->data,
+                              samples->count,
+                              begin,
+                              begin + 2);
+      accumulate_reconstruction (recon, count, coeffs, begin + 0);
+      accumulate_reconstruction (recon, count, coeffs, begin + 1);
+    }
+
+  // Higher coefficients past the best degree are left in place but
+  // are no longer part of the chain.
+  coeffs->count = 2 * best_degree + 1;
+  restore_arena (scratch, mark);
+
+  return best_degree;
+}
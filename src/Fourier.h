@@ -0,0 +1,46 @@
+#ifndef FOURIER_H
+#define FOURIER_H
+
+#include <stdint.h>
+
+#include "Utils.h"
+#include "Chain.h"
+
+typedef struct
+{
+  float max, rms;
+} FitError;
+
+typedef enum
+{
+  FIT_MAX,
+  FIT_RMS,
+} FitNorm;
+
+// Computes coefficients "[begin, end)" of the curve sampled at "count"
+// points "z" (three floats apart), where "count" is odd.
+void
+compute_fourier_coeffs (float *dst, float *z, size_t count,
+                        size_t begin, size_t end);
+
+void
+compute_fourier_series (float *dst, float *z, size_t count,
+                        uint32_t degree);
+
+void
+resample_closed_path (Arrayf *dst, const Arrayf *path, size_t count);
+
+FitError
+compute_fit_error (Arena *scratch, const Arrayf *coeffs,
+                   const Arrayf *samples);
+
+// Raises the degree from zero until the error of the reconstruction
+// against "samples" drops to "tolerance" or "max_degree" is reached,
+// which is capped at half the number of sample intervals. Returns the
+// first degree within the tolerance, or else the one with the smallest
+// error, "coeffs->count" is set accordingly.
+uint32_t
+fit_fourier_series (Arena *scratch, Arrayf *coeffs, Arrayf *samples,
+                    uint32_t max_degree, FitNorm norm, float tolerance);
+
+#endif // FOURIER_H
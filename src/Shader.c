@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <GL/glew.h>
+
+#include "Shader.h"
+
+gluint
+create_shader (Arena *scratch, glenum shader_type, const char *path)
+{
+  gluint shader = glCreateShader (shader_type);
+
+  size_t const mark = get_arena_mark (scratch);
+
+  size_t file_size;
+  char *file_data = read_entire_file (scratch, path, &file_size);
+
+  {
+    glint size = file_size;
+    glShaderSource (shader, 1, (void *)&file_data, &size);
+  }
+
+  glint status;
+  glCompileShader (shader);
+  glGetShaderiv (shader, GL_COMPILE_STATUS, &status);
+
+  if (status != GL_TRUE)
+    {
+      glint info_log_length;
+      glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &info_log_length);
+
+      char *error_message = allocate_in_arena (scratch,
+                                               info_log_length + 1);
+
+      glGetShaderInfoLog (shader,
+                          info_log_length,
+                          NULL,
+                          error_message);
+
+      fprintf (stderr,
+               "ERROR: failed to compile %s shader: %s",
+               shader_type == GL_VERTEX_SHADER
+                 ? "vertex" : "fragment",
+               error_message);
+
+      glDeleteShader (shader);
+      exit (EXIT_FAILURE);
+    }
+
+  restore_arena (scratch, mark);
+
+  return shader;
+}
+
+gluint
+create_program (Arena *scratch,
+                gluint vertex_shader, gluint fragment_shader)
+{
+  gluint program = glCreateProgram ();
+
+  glint status;
+  glAttachShader (program, vertex_shader);
+  glAttachShader (program, fragment_shader);
+  glLinkProgram (program);
+  glGetProgramiv (program, GL_LINK_STATUS, &status);
+
+  if (status != GL_TRUE)
+    {
+      glint info_log_length;
+      glGetProgramiv (program, GL_INFO_LOG_LENGTH, &info_log_length);
+
+      char *error_message = allocate_in_arena (scratch,
+                                               info_log_length + 1);
+
+      glGetProgramInfoLog (program,
+                           info_log_length,
+                           NULL,
+                           error_message);
+
+      fprintf (stderr,
+               "ERROR: failed to link program: %s",
+               error_message);
+
+      glDeleteProgram (program);
+      exit (EXIT_FAILURE);
+    }
+
+  glDetachShader (program, vertex_shader);
+  glDetachShader (program, fragment_shader);
+
+  return program;
+}
@@ -0,0 +1,14 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include "gltypes.h"
+#include "Utils.h"
+
+gluint
+create_shader (Arena *scratch, glenum shader_type, const char *path);
+
+gluint
+create_program (Arena *scratch,
+                gluint vertex_shader, gluint fragment_shader);
+
+#endif // SHADER_H
@@ -1,15 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
-#include <GL/glew.h>
-
 #include "Utils.h"
 
+atomic_size_t allocation_count = 0;
+
 void *
 malloc_or_exit (size_t size)
 {
@@ -18,11 +21,86 @@ malloc_or_exit (size_t size)
   if (data == NULL)
     exit (EXIT_FAILURE);
 
+  ++allocation_count;
+
   return data;
 }
 
+size_t
+get_allocation_count (void)
+{
+  return allocation_count;
+}
+
+Arena
+create_arena (size_t capacity)
+{
+  Arena arena;
+
+  arena.data = malloc_or_exit (capacity);
+  arena.size = 0;
+  arena.capacity = capacity;
+
+  return arena;
+}
+
 void *
-read_entire_file (const char *path, size_t *file_size_loc)
+allocate_in_arena (Arena *arena, size_t size)
+{
+  size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+  if (size > arena->capacity - arena->size)
+    {
+      fprintf (stderr,
+               "ERROR: arena of %zu bytes is out of memory.\n",
+               arena->capacity);
+      exit (EXIT_FAILURE);
+    }
+
+  void *data = arena->data + arena->size;
+  arena->size += size;
+
+  return data;
+}
+
+size_t
+get_arena_space (const Arena *arena)
+{
+  return arena->capacity - arena->size;
+}
+
+void
+reset_arena (Arena *arena)
+{
+  arena->size = 0;
+}
+
+size_t
+get_arena_mark (const Arena *arena)
+{
+  return arena->size;
+}
+
+void
+restore_arena (Arena *arena, size_t mark)
+{
+  assert (mark <= arena->size);
+
+  arena->size = mark;
+}
+
+void
+destroy_arena (Arena *arena)
+{
+  free (arena->data);
+  arena->data = NULL;
+  arena->size = 0;
+  arena->capacity = 0;
+}
+
+void *
+read_entire_file (Arena *arena, const char *path,
+                  size_t *file_size_loc)
 {
   int file_desc = open (path, O_RDONLY);
 
@@ -40,7 +118,7 @@ read_entire_file (const char *path, size_t *file_size_loc)
     file_size = stats.st_size;
   }
 
-  char *file_data = malloc_or_exit (file_size + 1);
+  char *file_data = allocate_in_arena (arena, file_size + 1);
 
   if (read (file_desc, file_data, file_size) != (ssize_t)file_size)
     goto fail;
@@ -61,91 +139,159 @@ read_entire_file (const char *path, size_t *file_size_loc)
   exit (EXIT_FAILURE);
 }
 
-gluint
-create_shader (glenum shader_type, const char *path)
+float
+rand_rangef (float min, float max)
 {
-  gluint shader = glCreateShader (shader_type);
+  return (float)rand() / RAND_MAX * (max - min) + min;
+}
 
-  size_t file_size;
-  char *file_data = read_entire_file (path, &file_size);
+void *
+run_task_thread (void *data)
+{
+  TaskThread *const thread = data;
 
-  {
-    glint size = file_size;
-    glShaderSource (shader, 1, (void *)&file_data, &size);
-  }
+  pthread_mutex_lock (&thread->lock);
 
-  free (file_data);
+  while (true)
+    {
+      while (!thread->is_busy && !thread->should_stop)
+        pthread_cond_wait (&thread->wake, &thread->lock);
 
-  glint status;
-  glCompileShader (shader);
-  glGetShaderiv (shader, GL_COMPILE_STATUS, &status);
+      if (thread->should_stop)
+        break;
 
-  if (status != GL_TRUE)
-    {
-      glint info_log_length;
-      glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &info_log_length);
+      pthread_mutex_unlock (&thread->lock);
+      thread->task (thread->data);
+      pthread_mutex_lock (&thread->lock);
 
-      char *error_message = malloc (info_log_length + 1);
+      thread->is_busy = false;
+      pthread_cond_signal (&thread->done);
+    }
 
-      glGetShaderInfoLog (shader,
-                          info_log_length,
-                          NULL,
-                          error_message);
+  pthread_mutex_unlock (&thread->lock);
 
-      fprintf (stderr,
-               "ERROR: failed to compile %s shader: %s",
-               shader_type == GL_VERTEX_SHADER
-                 ? "vertex" : "fragment",
-               error_message);
+  return NULL;
+}
 
-      free (error_message);
-      glDeleteShader (shader);
-      exit (EXIT_FAILURE);
+void
+start_task_thread (TaskThread *thread)
+{
+  pthread_mutex_init (&thread->lock, NULL);
+  pthread_cond_init (&thread->wake, NULL);
+  pthread_cond_init (&thread->done, NULL);
+
+  thread->is_busy = false;
+  thread->should_stop = false;
+  thread->is_started = pthread_create (&thread->thread,
+                                       NULL,
+                                       run_task_thread,
+                                       thread) == 0;
+}
+
+// Waits for the previous task, if any, before handing over the next.
+void
+run_on_task_thread (TaskThread *thread, void (*task) (void *), void *data)
+{
+  if (!thread->is_started)
+    {
+      task (data);
+      return;
     }
 
-  return shader;
+  pthread_mutex_lock (&thread->lock);
+
+  while (thread->is_busy)
+    pthread_cond_wait (&thread->done, &thread->lock);
+
+  thread->task = task;
+  thread->data = data;
+  thread->is_busy = true;
+
+  pthread_cond_signal (&thread->wake);
+  pthread_mutex_unlock (&thread->lock);
 }
 
-gluint
-create_program (gluint vertex_shader, gluint fragment_shader)
+void
+wait_for_task_thread (TaskThread *thread)
 {
-  gluint program = glCreateProgram ();
+  if (!thread->is_started)
+    return;
 
-  glint status;
-  glAttachShader (program, vertex_shader);
-  glAttachShader (program, fragment_shader);
-  glLinkProgram (program);
-  glGetProgramiv (program, GL_LINK_STATUS, &status);
+  pthread_mutex_lock (&thread->lock);
 
-  if (status != GL_TRUE)
-    {
-      glint info_log_length;
-      glGetProgramiv (program, GL_INFO_LOG_LENGTH, &info_log_length);
+  while (thread->is_busy)
+    pthread_cond_wait (&thread->done, &thread->lock);
 
-      char *error_message = malloc (info_log_length + 1);
+  pthread_mutex_unlock (&thread->lock);
+}
 
-      glGetProgramInfoLog (program,
-                           info_log_length,
-                           NULL,
-                           error_message);
+void
+stop_task_thread (TaskThread *thread)
+{
+  if (thread->is_started)
+    {
+      wait_for_task_thread (thread);
 
-      fprintf (stderr,
-               "ERROR: failed to link program: %s",
-               error_message);
+      pthread_mutex_lock (&thread->lock);
+      thread->should_stop = true;
+      pthread_cond_signal (&thread->wake);
+      pthread_mutex_unlock (&thread->lock);
 
-      free (error_message);
-      glDeleteProgram (program);
-      exit (EXIT_FAILURE);
+      pthread_join (thread->thread, NULL);
     }
 
-  glDetachShader (program, vertex_shader);
-  glDetachShader (program, fragment_shader);
+  pthread_cond_destroy (&thread->done);
+  pthread_cond_destroy (&thread->wake);
+  pthread_mutex_destroy (&thread->lock);
+}
+
+double
+get_seconds (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
 
-  return program;
+  return now.tv_sec + now.tv_nsec * 1e-9;
 }
 
-float
-rand_rangef (float min, float max)
+Arrayf
+create_arrayf (size_t comps, size_t capacity)
 {
-  return (float)rand() / RAND_MAX * (max - min) + min;
+  assert (comps > 0 && capacity > 0);
+
+  Arrayf arr;
+
+  arr.data = malloc_or_exit (comps * capacity * sizeof (float));
+  arr.comps = comps;
+  arr.count = 0;
+  arr.capacity = capacity;
+
+  return arr;
+}
+
+Arrayf
+allocate_arrayf (Arena *arena, size_t comps, size_t capacity)
+{
+  assert (comps > 0 && capacity > 0);
+
+  Arrayf arr;
+
+  arr.data = allocate_in_arena (arena, comps * capacity * sizeof (float));
+  arr.comps = comps;
+  arr.count = 0;
+  arr.capacity = capacity;
+
+  return arr;
+}
+
+size_t
+get_total_size_of_arrayf (const Arrayf *arr)
+{
+  return arr->comps * arr->capacity * sizeof (float);
+}
+
+size_t
+get_size_of_arrayf (const Arrayf *arr)
+{
+  return arr->comps * arr->count * sizeof (float);
 }
@@ -1,21 +1,106 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-#include "gltypes.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <pthread.h>
+
+#define ARENA_ALIGNMENT 16
+
+typedef struct
+{
+  float *data;
+  size_t comps;
+  size_t count;
+  size_t capacity;
+} Arrayf;
+
+// Linear allocator: allocations are bumped off a fixed block and
+// released all at once by "reset_arena".
+typedef struct
+{
+  char *data;
+  size_t size;
+  size_t capacity;
+} Arena;
+
+// Thread that stays alive between tasks, so handing it work does not
+// create a thread or allocate. Tasks run inline if it failed to start.
+typedef struct
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake, done;
+  void (*task) (void *);
+  void *data;
+  bool is_started, is_busy, should_stop;
+} TaskThread;
 
 void *
 malloc_or_exit (size_t size);
 
+// Number of heap allocations made through this module so far, meant
+// to check that hot paths allocate nothing.
+size_t
+get_allocation_count (void);
+
+Arena
+create_arena (size_t capacity);
+
 void *
-read_entire_file (const char *path, size_t *file_size_loc);
+allocate_in_arena (Arena *arena, size_t size);
+
+size_t
+get_arena_space (const Arena *arena);
+
+void
+reset_arena (Arena *arena);
 
-gluint
-create_shader (glenum shader_type, const char *path);
+// Everything allocated after "get_arena_mark" is released by passing
+// the mark to "restore_arena".
+size_t
+get_arena_mark (const Arena *arena);
 
-gluint
-create_program (gluint vertex_shader, gluint fragment_shader);
+void
+restore_arena (Arena *arena, size_t mark);
+
+void
+destroy_arena (Arena *arena);
+
+void *
+read_entire_file (Arena *arena, const char *path,
+                  size_t *file_size_loc);
 
 float
 rand_rangef (float min, float max);
 
+void
+start_task_thread (TaskThread *thread);
+
+void
+run_on_task_thread (TaskThread *thread, void (*task) (void *), void *data);
+
+void
+wait_for_task_thread (TaskThread *thread);
+
+void
+stop_task_thread (TaskThread *thread);
+
+// Monotonic wall clock in seconds, for timing.
+double
+get_seconds (void);
+
+Arrayf
+create_arrayf (size_t comps, size_t capacity);
+
+Arrayf
+allocate_arrayf (Arena *arena, size_t comps, size_t capacity);
+
+size_t
+get_total_size_of_arrayf (const Arrayf *arr);
+
+size_t
+get_size_of_arrayf (const Arrayf *arr);
+
 #endif // UTILS_H
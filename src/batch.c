@@ -0,0 +1,597 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Utils.h"
+#include "Fourier.h"
+
+#define DEFAULT_SAMPLES_COUNT 257
+#define MAX_DEGREES_COUNT 16
+#define MAX_THREADS_COUNT 256
+#define MAX_SAMPLES_COUNT (1 << 20)
+#define MAX_INPUT_POINTS (1 << 18)
+
+typedef struct
+{
+  const char *output_dir;
+  uint32_t degrees[MAX_DEGREES_COUNT];
+  size_t degrees_count;
+  uint32_t max_degree;
+  size_t samples_count;
+  size_t threads_count;
+  float tolerance;
+  FitNorm norm;
+} Options;
+
+typedef struct
+{
+  char **data;
+  size_t count;
+  size_t capacity;
+} Paths;
+
+// Jobs "[begin, end)" owned by one worker. The owner takes jobs from
+// the front, thieves take half of what is left from the back.
+typedef struct
+{
+  pthread_mutex_t lock;
+  size_t begin, end;
+} JobQueue;
+
+typedef struct
+{
+  const Options *options;
+  const Paths *inputs;
+  JobQueue queues[MAX_THREADS_COUNT];
+  atomic_size_t done_count, failed_count;
+} Pool;
+
+typedef struct
+{
+  Pool *pool;
+  size_t id;
+} Worker;
+
+void
+push_path (Paths *paths, const char *dir, const char *name)
+{
+  if (paths->count >= paths->capacity)
+    {
+      paths->capacity = paths->capacity > 0 ? 2 * paths->capacity : 64;
+      paths->data = realloc (paths->data,
+                             paths->capacity * sizeof (char *));
+
+      if (paths->data == NULL)
+        exit (EXIT_FAILURE);
+    }
+
+  size_t const dir_length = dir != NULL ? strlen (dir) : 0;
+  size_t const name_length = strlen (name);
+  char *path = malloc_or_exit (dir_length + name_length + 2);
+
+  if (dir != NULL)
+    {
+      memcpy (path, dir, dir_length);
+      path[dir_length] = '/';
+      memcpy (path + dir_length + 1, name, name_length + 1);
+    }
+  else
+    memcpy (path, name, name_length + 1);
+
+  paths->data[paths->count++] = path;
+}
+
+void
+collect_inputs (Paths *paths, const char *path)
+{
+  struct stat stats;
+
+  if (stat (path, &stats) == -1)
+    {
+      fprintf (stderr, "ERROR: failed to access \'%s\'.\n", path);
+      exit (EXIT_FAILURE);
+    }
+
+  if (!S_ISDIR (stats.st_mode))
+    {
+      push_path (paths, NULL, path);
+      return;
+    }
+
+  DIR *dir = opendir (path);
+
+  if (dir == NULL)
+    {
+      fprintf (stderr, "ERROR: failed to open directory \'%s\'.\n", path);
+      exit (EXIT_FAILURE);
+    }
+
+  struct dirent *entry;
+
+  while ((entry = readdir (dir)) != NULL)
+    {
+      if (entry->d_name[0] == '.')
+        continue;
+
+      push_path (paths, path, entry->d_name);
+    }
+
+  closedir (dir);
+}
+
+// Reads "x y" pairs line by line, skipping empty lines and lines
+// starting with '#'. Fails when "dst" is too small to hold them.
+bool
+read_path (Arrayf *dst, const char *path)
+{
+  FILE *file = fopen (path, "r");
+
+  if (file == NULL)
+    return false;
+
+  char line[256];
+  bool is_ok = true;
+
+  dst->count = 0;
+
+  while (fgets (line, sizeof (line), file) != NULL)
+    {
+      char *next = line + strspn (line, " \t");
+
+      if (*next == '#' || *next == '\n' || *next == '\0')
+        continue;
+
+      float x, y;
+
+      if (sscanf (next, "%f %f", &x, &y) != 2)
+        {
+          is_ok = false;
+          break;
+        }
+
+      if (dst->count >= dst->capacity)
+        {
+          is_ok = false;
+          break;
+        }
+
+      float *point = dst->data + 2 * dst->count;
+      point[0] = x;
+      point[1] = y;
+
+      ++dst->count;
+    }
+
+  is_ok = is_ok && !ferror (file) && dst->count >= 2;
+
+  fclose (file);
+
+  return is_ok;
+}
+
+const char *
+get_file_name (const char *path)
+{
+  const char *name = strrchr (path, '/');
+
+  return name != NULL ? name + 1 : path;
+}
+
+int
+compare_file_names (const void *a, const void *b)
+{
+  return strcmp (get_file_name (*(char *const *)a),
+                 get_file_name (*(char *const *)b));
+}
+
+// Outputs are named after the input file only, so two inputs with the
+// same name would overwrite each other's coefficients.
+void
+check_file_names (const Paths *inputs)
+{
+  if (inputs->count < 2)
+    return;
+
+  char **sorted = malloc_or_exit (inputs->count * sizeof (char *));
+  memcpy (sorted, inputs->data, inputs->count * sizeof (char *));
+  qsort (sorted, inputs->count, sizeof (char *), compare_file_names);
+
+  for (size_t i = 1; i < inputs->count; i++)
+    {
+      if (compare_file_names (sorted + i - 1, sorted + i) == 0)
+        {
+          fprintf (stderr,
+                   "ERROR: inputs \'%s\' and \'%s\' have the same "
+                   "name.\n",
+                   sorted[i - 1],
+                   sorted[i]);
+          exit (EXIT_FAILURE);
+        }
+    }
+
+  free (sorted);
+}
+
+bool
+write_coeffs (const char *path, const Arrayf *coeffs, uint32_t degree,
+              FitError error)
+{
+  FILE *file = fopen (path, "w");
+
+  if (file == NULL)
+    return false;
+
+  fprintf (file,
+           "# degree %u max_error %g rms_error %g\n",
+           degree,
+           error.max,
+           error.rms);
+
+  // Coefficients are in chain order, write them by frequency.
+  for (int32_t freq = -(int32_t)degree; freq <= (int32_t)degree; freq++)
+    {
+      size_t ind = freq < 0 ? -2 * freq - 1 : 2 * freq;
+
+      fprintf (file,
+               "%d %.9g %.9g\n",
+               freq,
+               coeffs->data[2 * ind + 0],
+               coeffs->data[2 * ind + 1]);
+    }
+
+  bool is_ok = !ferror (file);
+
+  return fclose (file) == 0 && is_ok;
+}
+
+// Everything "process_file" allocates at once: the path, the samples,
+// the coefficients and the reconstruction of the fit error, each with
+// room for alignment.
+size_t
+get_worker_arena_size (const Options *options)
+{
+  size_t const floats_count = 2 * MAX_INPUT_POINTS
+                              + 3 * options->samples_count
+                              + 2 * (2 * options->max_degree + 1)
+                              + 2 * options->samples_count;
+
+  return floats_count * sizeof (float) + 4 * ARENA_ALIGNMENT;
+}
+
+bool
+process_file (const Options *options, const char *input, Arena *scratch)
+{
+  uint32_t const max_degree = options->max_degree;
+
+  Arrayf path = allocate_arrayf (scratch, 2, MAX_INPUT_POINTS);
+  Arrayf samples = allocate_arrayf (scratch, 3, options->samples_count);
+  Arrayf coeffs = allocate_arrayf (scratch, 2, 2 * max_degree + 1);
+
+  if (!read_path (&path, input))
+    {
+      fprintf (stderr,
+               "ERROR: failed to read path \'%s\', it must have 2 to %d "
+               "points.\n",
+               input,
+               MAX_INPUT_POINTS);
+      return false;
+    }
+
+  resample_closed_path (&samples, &path, options->samples_count);
+
+  const char *name = get_file_name (input);
+
+  // With a tolerance, the degree is chosen per file and the largest
+  // of the requested ones is only an upper bound.
+  size_t const runs_count = options->tolerance > 0
+                            ? 1 : options->degrees_count;
+
+  for (size_t i = 0; i < runs_count; i++)
+    {
+      uint32_t degree = options->degrees[i];
+
+      if (options->tolerance > 0)
+        degree = fit_fourier_series (scratch,
+                                     &coeffs,
+                                     &samples,
+                                     max_degree,
+                                     options->norm,
+                                     options->tolerance);
+      else
+        {
+          compute_fourier_series (coeffs.data,
+                                  samples.data,
+                                  samples.count,
+                                  degree);
+          coeffs.count = 2 * degree + 1;
+        }
+
+      FitError error = compute_fit_error (scratch, &coeffs, &samples);
+
+      char output[4096];
+      snprintf (output,
+                sizeof (output),
+                "%s/%s.%u.coeffs",
+                options->output_dir,
+                name,
+                degree);
+
+      if (!write_coeffs (output, &coeffs, degree, error))
+        {
+          fprintf (stderr, "ERROR: failed to write \'%s\'.\n", output);
+          return false;
+        }
+
+      flockfile (stdout);
+      printf ("%s\t%u\t%g\t%g\n", input, degree, error.max, error.rms);
+      funlockfile (stdout);
+    }
+
+  return true;
+}
+
+bool
+take_job (JobQueue *queue, size_t *job)
+{
+  bool is_taken = false;
+
+  pthread_mutex_lock (&queue->lock);
+
+  if (queue->begin < queue->end)
+    {
+      *job = queue->begin++;
+      is_taken = true;
+    }
+
+  pthread_mutex_unlock (&queue->lock);
+
+  return is_taken;
+}
+
+bool
+steal_jobs (Pool *pool, size_t thief, size_t *job)
+{
+  size_t const threads_count = pool->options->threads_count;
+
+  for (size_t i = 1; i < threads_count; i++)
+    {
+      JobQueue *victim = pool->queues + (thief + i) % threads_count;
+      size_t begin = 0, end = 0;
+
+      pthread_mutex_lock (&victim->lock);
+
+      if (victim->begin < victim->end)
+        {
+          size_t const left = victim->end - victim->begin;
+
+          begin = victim->end - (left + 1) / 2;
+          end = victim->end;
+          victim->end = begin;
+        }
+
+      pthread_mutex_unlock (&victim->lock);
+
+      if (begin < end)
+        {
+          JobQueue *own = pool->queues + thief;
+
+          pthread_mutex_lock (&own->lock);
+          own->begin = begin + 1;
+          own->end = end;
+          pthread_mutex_unlock (&own->lock);
+
+          *job = begin;
+
+          return true;
+        }
+    }
+
+  return false;
+}
+
+void *
+run_worker (void *data)
+{
+  Worker *const worker = data;
+  Pool *const pool = worker->pool;
+  const Options *const options = pool->options;
+
+  Arena scratch = create_arena (get_worker_arena_size (options));
+
+  size_t job;
+
+  while (take_job (pool->queues + worker->id, &job)
+         || steal_jobs (pool, worker->id, &job))
+    {
+      reset_arena (&scratch);
+
+      if (!process_file (options, pool->inputs->data[job], &scratch))
+        atomic_fetch_add (&pool->failed_count, 1);
+
+      atomic_fetch_add (&pool->done_count, 1);
+    }
+
+  destroy_arena (&scratch);
+
+  return NULL;
+}
+
+void
+print_usage (const char *program)
+{
+  fprintf (stderr,
+           "usage: %s [-j threads] [-d degree[,degree...]] "
+           "[-e tolerance [-r]] [-n samples] [-o output_dir] "
+           "input...\n",
+           program);
+}
+
+void
+parse_degrees (Options *options, char *list)
+{
+  options->degrees_count = 0;
+  options->max_degree = 0;
+
+  for (char *next = strtok (list, ","); next != NULL;
+       next = strtok (NULL, ","))
+    {
+      if (options->degrees_count >= MAX_DEGREES_COUNT)
+        {
+          fputs ("ERROR: too many degrees.\n", stderr);
+          exit (EXIT_FAILURE);
+        }
+
+      uint32_t const degree = atoi (next);
+
+      options->degrees[options->degrees_count++] = degree;
+
+      if (degree > options->max_degree)
+        options->max_degree = degree;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  Options options;
+  options.output_dir = ".";
+  options.degrees[0] = 16;
+  options.degrees_count = 1;
+  options.max_degree = 16;
+  options.samples_count = DEFAULT_SAMPLES_COUNT;
+  options.threads_count = sysconf (_SC_NPROCESSORS_ONLN);
+  options.tolerance = 0;
+  options.norm = FIT_MAX;
+
+  int opt;
+
+  while ((opt = getopt (argc, argv, "j:d:e:rn:o:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'j':
+          options.threads_count = atoi (optarg);
+          break;
+        case 'd':
+          parse_degrees (&options, optarg);
+          break;
+        case 'e':
+          options.tolerance = atof (optarg);
+          break;
+        case 'r':
+          options.norm = FIT_RMS;
+          break;
+        case 'n':
+          options.samples_count = atoi (optarg);
+          break;
+        case 'o':
+          options.output_dir = optarg;
+          break;
+        default:
+          print_usage (argv[0]);
+          exit (EXIT_FAILURE);
+        }
+    }
+
+  if (optind >= argc || options.degrees_count == 0)
+    {
+      print_usage (argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  if (options.samples_count > MAX_SAMPLES_COUNT)
+    {
+      fprintf (stderr,
+               "ERROR: at most %d samples are supported.\n",
+               MAX_SAMPLES_COUNT);
+      exit (EXIT_FAILURE);
+    }
+
+  // Simpson's rule needs an odd number of samples.
+  if (options.samples_count < 3)
+    options.samples_count = 3;
+
+  options.samples_count |= 1;
+
+  if (options.threads_count < 1)
+    options.threads_count = 1;
+  else if (options.threads_count > MAX_THREADS_COUNT)
+    options.threads_count = MAX_THREADS_COUNT;
+
+  Paths inputs = { NULL, 0, 0 };
+
+  for (int i = optind; i < argc; i++)
+    collect_inputs (&inputs, argv[i]);
+
+  check_file_names (&inputs);
+
+  static Pool pool;
+  pool.options = &options;
+  pool.inputs = &inputs;
+  atomic_init (&pool.done_count, 0);
+  atomic_init (&pool.failed_count, 0);
+
+  size_t const threads_count = options.threads_count;
+
+  for (size_t i = 0; i < threads_count; i++)
+    {
+      pthread_mutex_init (&pool.queues[i].lock, NULL);
+      pool.queues[i].begin = inputs.count * i / threads_count;
+      pool.queues[i].end = inputs.count * (i + 1) / threads_count;
+    }
+
+  Worker workers[MAX_THREADS_COUNT];
+  pthread_t threads[MAX_THREADS_COUNT];
+
+  double const start_time = get_seconds ();
+
+  for (size_t i = 0; i < threads_count; i++)
+    {
+      workers[i].pool = &pool;
+      workers[i].id = i;
+
+      if (i > 0
+          && pthread_create (threads + i, NULL, run_worker, workers + i)
+               != 0)
+        {
+          fputs ("ERROR: failed to start worker thread.\n", stderr);
+          exit (EXIT_FAILURE);
+        }
+    }
+
+  run_worker (workers + 0);
+
+  for (size_t i = 1; i < threads_count; i++)
+    pthread_join (threads[i], NULL);
+
+  double const elapsed = get_seconds () - start_time;
+  size_t const done_count = atomic_load (&pool.done_count);
+  size_t const failed_count = atomic_load (&pool.failed_count);
+
+  fprintf (stderr,
+           "%zu files (%zu failed) in %.3f s with %zu threads: "
+           "%.1f files/s\n",
+           done_count,
+           failed_count,
+           elapsed,
+           threads_count,
+           elapsed > 0 ? done_count / elapsed : 0.0);
+
+  for (size_t i = 0; i < threads_count; i++)
+    pthread_mutex_destroy (&pool.queues[i].lock);
+
+  for (size_t i = 0; i < inputs.count; i++)
+    free (inputs.data[i]);
+
+  free (inputs.data);
+
+  return failed_count > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
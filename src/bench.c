@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "Utils.h"
+#include "Chain.h"
+
+#define EVALUATIONS_COUNT 200000
+
+// Nanoseconds per chain evaluation, accumulating the tip in "sink" so
+// the calls can not be dropped.
+double
+time_chain (bool use_generic, float *circles, const Arrayf *coeffs,
+            float *sink)
+{
+  double const start = get_seconds ();
+
+  for (size_t i = 0; i < EVALUATIONS_COUNT; i++)
+    {
+      float const t = 2 * M_PI / EVALUATIONS_COUNT * i;
+
+      if (use_generic)
+        evaluate_chain_generic (circles, 2, coeffs, t);
+      else
+        evaluate_chain (circles, 2, coeffs, t);
+
+      *sink += circles[2 * (coeffs->count - 1)];
+    }
+
+  return (get_seconds () - start) * 1e9 / EVALUATIONS_COUNT;
+}
+
+int
+main (void)
+{
+  uint32_t const degrees[] = { 8, 16, 32, 64 };
+
+  Arrayf coeffs = create_arrayf (2, 2 * 64 + 1);
+  Arrayf generic = create_arrayf (2, 2 * 64 + 1);
+  Arrayf special = create_arrayf (2, 2 * 64 + 1);
+
+  for (size_t i = 0; i < coeffs.capacity; i++)
+    {
+      float const freq = get_frequency (i);
+      float const scale = 1.0 / (1 + freq * freq);
+
+      coeffs.data[2 * i + 0] = rand_rangef (-1, 1) * scale;
+      coeffs.data[2 * i + 1] = rand_rangef (-1, 1) * scale;
+    }
+
+  float sink = 0;
+
+  printf ("degree\tgeneric ns\tspecialized ns\tspeedup\tmax diff\n");
+
+  for (size_t d = 0; d < sizeof (degrees) / sizeof (*degrees); d++)
+    {
+      coeffs.count = 2 * degrees[d] + 1;
+
+      double const generic_ns
+        = time_chain (true, generic.data, &coeffs, &sink);
+      double const special_ns
+        = time_chain (false, special.data, &coeffs, &sink);
+
+      float max_diff = 0;
+
+      for (size_t i = 0; i < 64; i++)
+        {
+          float const t = 2 * M_PI / 64 * i;
+
+          evaluate_chain_generic (generic.data, 2, &coeffs, t);
+          evaluate_chain (special.data, 2, &coeffs, t);
+
+          for (size_t j = 0; j < 2 * coeffs.count; j++)
+            {
+              float const diff = fabs (generic.data[j] - special.data[j]);
+              max_diff = diff > max_diff ? diff : max_diff;
+            }
+        }
+
+      printf ("%u\t%.1f\t\t%.1f\t\t%.2fx\t%g\n",
+              degrees[d],
+              generic_ns,
+              special_ns,
+              generic_ns / special_ns,
+              max_diff);
+    }
+
+  fprintf (stderr, "(%g)\n", sink);
+
+  free (special.data);
+  free (generic.data);
+  free (coeffs.data);
+
+  return EXIT_SUCCESS;
+}
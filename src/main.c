@@ -3,55 +3,53 @@
 #include <math.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdarg.h>
 #include <assert.h>
+#include <stdatomic.h>
+
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include "Utils.h"
+#include "Shader.h"
+#include "Fourier.h"
 
 #define CIRCLE_SAMPLES 64
 #define MAX_POINTS_COUNT 128
 
 #define FOURIER_DEGREE 16
+#define MAX_FOURIER_DEGREE 64
 
-#define SCREEN_WIDTH 800
-#define SCREEN_HEIGHT 600
-
-typedef struct
-{
-  float *data;
-  size_t comps;
-  size_t count;
-  size_t capacity;
-} Arrayf;
+// Largest distance in pixels between the drawing and its chain that is
+// accepted when the degree is chosen automatically.
+#define AUTO_DEGREE_TOLERANCE 1.5
 
-Arrayf
-create_arrayf (size_t comps, size_t capacity)
-{
-  assert (comps > 0 && capacity > 0);
+// One period of the animation is sampled this many times when the
+// trace cache is enabled, split across this many threads. With a
+// single thread the cache is filled serially on the calling thread.
+#define TRACE_CACHE_SAMPLES 1024
+#define TRACE_CACHE_THREADS 4
 
-  Arrayf arr;
+// Seconds it takes to blend one drawing into the next.
+#define MORPH_DURATION 2.0
 
-  arr.data = malloc_or_exit (comps * capacity * sizeof (float));
-  arr.comps = comps;
-  arr.count = 0;
-  arr.capacity = capacity;
+#define FRAME_ARENA_SIZE (64 * 1024)
+#define TRANSFORM_ARENA_SIZE (1024 * 1024)
 
-  return arr;
-}
+// Replays advance the clock by a fixed step, sample the tip every few
+// frames and accept this much difference against a golden report.
+#define REPLAY_FRAME_TIME (1.0 / 60.0)
+#define REPLAY_TIP_INTERVAL 10
+#define REPLAY_TOLERANCE 1e-3
 
-size_t
-get_total_size_of_arrayf (const Arrayf *arr)
-{
-  return arr->comps * arr->capacity * sizeof (float);
-}
+// Coefficients are rounded to this step before hashing. A value close
+// to a rounding boundary still flips the hash between builds, so it is
+// only informational and golden reports do not compare it.
+#define COEFF_HASH_QUANTUM 1e-3
 
-size_t
-get_size_of_arrayf (const Arrayf *arr)
-{
-  return arr->comps * arr->count * sizeof (float);
-}
+#define SCREEN_WIDTH 800
+#define SCREEN_HEIGHT 600
 
 float const aspect_ratio = (float)SCREEN_WIDTH / SCREEN_HEIGHT;
 float const left = -4, right = 4;
@@ -65,14 +63,93 @@ const float ortho[4 * 4]
 
 bool is_left_mouse_button_pressed = false;
 
+typedef enum
+{
+  MORPH_LINEAR,
+  MORPH_POLAR,
+} MorphKind;
+
 struct
 {
   gluint points_buffer;
-  Arrayf points, coeffs;
+  Arrayf points, coeffs, circles, trace_cache;
+  Arena frame_arena, transform_arena;
+  TaskThread trace_cache_threads[TRACE_CACHE_THREADS > 1
+                                 ? TRACE_CACHE_THREADS - 1 : 1];
   float line_trace[4], start_time;
   bool is_fourier_series_ready;
+  bool use_trace_cache, is_trace_cache_ready, is_full_curve_drawn;
+  bool should_clear_trace;
+  bool use_auto_degree, use_morph;
+  FitNorm fit_norm;
+  MorphKind morph_kind;
+  size_t coeffs_version;
 } context;
 
+struct
+{
+  TaskThread worker;
+  Arena arena;
+  Arrayf points, result, source, target;
+  float start_time;
+  double job_seconds;
+  atomic_bool is_job_done;
+  bool use_auto_degree, is_job_running, is_morphing;
+  FitNorm fit_norm;
+} morph;
+
+typedef struct
+{
+  double total;
+  size_t calls;
+} Timing;
+
+struct
+{
+  Timing transform, chain, upload;
+} timings;
+
+// Input is recorded to or replayed from a text file with one event per
+// line: "<time> cursor <x> <y>", "<time> button <button> <action>",
+// "<time> key <key> <action>" or "<time> end". Replays run without a
+// window, on a virtual clock.
+struct
+{
+  FILE *record, *input, *golden;
+  double time;
+  size_t mismatches_count;
+  bool is_enabled, should_close;
+} replay;
+
+double
+get_time (void)
+{
+  return replay.is_enabled ? replay.time : glfwGetTime ();
+}
+
+void
+add_timing (Timing *timing, double seconds)
+{
+  timing->total += seconds;
+  ++timing->calls;
+}
+
+void
+record_event (const char *format, ...)
+{
+  if (replay.record == NULL)
+    return;
+
+  va_list args;
+  va_start (args, format);
+
+  fprintf (replay.record, "%.6f ", glfwGetTime ());
+  vfprintf (replay.record, format, args);
+  fputc ('\n', replay.record);
+
+  va_end (args);
+}
+
 void
 mouse_button_callback (GLFWwindow *win,
                        int button, int action, int mods)
@@ -80,6 +157,8 @@ mouse_button_callback (GLFWwindow *win,
   (void)win;
   (void)mods;
 
+  record_event ("button %d %d", button, action);
+
   if (button == GLFW_MOUSE_BUTTON_LEFT)
     is_left_mouse_button_pressed = (action == GLFW_PRESS);
 }
@@ -90,6 +169,8 @@ mouse_cursor_pos_callback (GLFWwindow *win,
 {
   (void)win;
 
+  record_event ("cursor %.9g %.9g", xpos, ypos);
+
   if (is_left_mouse_button_pressed)
     {
       size_t const count = context.points.count;
@@ -116,73 +197,363 @@ mouse_cursor_pos_callback (GLFWwindow *win,
       point[1] = ypos;
       point[2] = (right - left) / 200;
 
-      glBindBuffer (GL_ARRAY_BUFFER, context.points_buffer);
-      glBufferSubData (GL_ARRAY_BUFFER,
-                       (point - context.points.data)
-                         * sizeof (float),
-                       3 * sizeof (float),
-                       point);
+      if (!replay.is_enabled)
+        {
+          glBindBuffer (GL_ARRAY_BUFFER, context.points_buffer);
+          glBufferSubData (GL_ARRAY_BUFFER,
+                           (point - context.points.data)
+                             * sizeof (float),
+                           3 * sizeof (float),
+                           point);
+        }
 
       ++context.points.count;
     }
 }
 
-typedef struct Vec2f Vec2f;
+void
+compute_circle_radii (Arrayf *circles, const Arrayf *coeffs)
+{
+  for (size_t i = 1; i < coeffs->count; i++)
+    {
+      float x = coeffs->data[2 * i + 0];
+      float y = coeffs->data[2 * i + 1];
+
+      circles->data[3 * (i - 1) + 2] = sqrt (x * x + y * y);
+    }
+}
+
+typedef struct
+{
+  const Arrayf *coeffs;
+  Arrayf *cache;
+  size_t begin, end;
+} TraceCacheJob;
+
+void
+fill_trace_cache_range (void *data)
+{
+  TraceCacheJob *const job = data;
+  size_t const comps = job->cache->comps;
+  float const dt = 2.0 * M_PI / job->cache->capacity;
+
+  for (size_t i = job->begin; i < job->end; i++)
+    evaluate_chain (job->cache->data + comps * i,
+                    2,
+                    job->coeffs,
+                    dt * i);
+}
+
+// Samples one full period of the chain, which is "2 * pi" since all
+// frequencies are integers. Every row of the cache holds the centers
+// of all circles at that time.
+void
+compute_trace_cache (Arrayf *cache, const Arrayf *coeffs)
+{
+  assert (cache->comps >= 2 * coeffs->count);
+
+  size_t const capacity = cache->capacity;
+  size_t const batch = (capacity + TRACE_CACHE_THREADS - 1)
+                       / TRACE_CACHE_THREADS;
+
+  TraceCacheJob jobs[TRACE_CACHE_THREADS];
+
+  for (size_t i = 0; i < TRACE_CACHE_THREADS; i++)
+    {
+      size_t begin = i * batch, end = begin + batch;
+
+      jobs[i].coeffs = coeffs;
+      jobs[i].cache = cache;
+      jobs[i].begin = begin < capacity ? begin : capacity;
+      jobs[i].end = end < capacity ? end : capacity;
+    }
+
+  // The first batch is always done on the calling thread, the rest on
+  // threads that were started once in "init_context".
+  for (size_t i = 1; i < TRACE_CACHE_THREADS; i++)
+    run_on_task_thread (context.trace_cache_threads + i - 1,
+                        fill_trace_cache_range,
+                        jobs + i);
+
+  fill_trace_cache_range (jobs);
+
+  for (size_t i = 1; i < TRACE_CACHE_THREADS; i++)
+    wait_for_task_thread (context.trace_cache_threads + i - 1);
+
+  cache->count = capacity;
+}
+
+// Linearly interpolates circle centers at time "t" from the cache.
+void
+sample_trace_cache (Arrayf *circles, const Arrayf *cache, float t)
+{
+  size_t const count = cache->count;
+  size_t const comps = cache->comps;
+
+  float const u = fmod (t, 2 * M_PI) / (2 * M_PI) * count;
+  size_t const j = (size_t)u % count;
+  float const w = u - floor (u);
+
+  float const *const a = cache->data + comps * j;
+  float const *const b = cache->data + comps * ((j + 1) % count);
+
+  for (size_t i = 0; i < circles->count; i++)
+    {
+      float *const next = circles->data + 3 * i;
+      next[0] = a[2 * i + 0] + w * (b[2 * i + 0] - a[2 * i + 0]);
+      next[1] = a[2 * i + 1] + w * (b[2 * i + 1] - a[2 * i + 1]);
+    }
+}
+
+void
+transform_points (Arena *scratch, Arrayf *coeffs, const Arrayf *points,
+                  bool use_auto_degree, FitNorm fit_norm)
+{
+  size_t const count = points->count;
+
+  // Simpson's rule needs an odd number of points, so an even count
+  // gets the midpoint between the last and the first one.
+  Arrayf z = allocate_arrayf (scratch, 3, count + 1);
+
+  memcpy (z.data, points->data, get_size_of_arrayf (points));
+  z.count = count;
+
+  if (count % 2 == 0)
+    {
+      float const *const first = z.data;
+      float const *const last = z.data + 3 * (count - 1);
+      float *const mid = z.data + 3 * count;
+
+      mid[0] = (first[0] + last[0]) / 2;
+      mid[1] = (first[1] + last[1]) / 2;
+      mid[2] = 0;
+
+      ++z.count;
+    }
+
+  if (use_auto_degree)
+    {
+      float const tolerance = AUTO_DEGREE_TOLERANCE
+                              * (right - left) / SCREEN_WIDTH;
+
+      fit_fourier_series (scratch,
+                          coeffs,
+                          &z,
+                          MAX_FOURIER_DEGREE,
+                          fit_norm,
+                          tolerance);
+    }
+  else
+    {
+      compute_fourier_series (coeffs->data,
+                              z.data,
+                              z.count,
+                              FOURIER_DEGREE);
+      coeffs->count = 2 * FOURIER_DEGREE + 1;
+    }
+}
 
-struct Vec2f
+void
+run_morph_job (void *data)
 {
-  float x, y;
-};
+  (void)data;
+
+  double const start = get_seconds ();
+
+  transform_points (&morph.arena,
+                    &morph.result,
+                    &morph.points,
+                    morph.use_auto_degree,
+                    morph.fit_norm);
+
+  morph.job_seconds = get_seconds () - start;
 
+  atomic_store (&morph.is_job_done, true);
+}
+
+// Transforms a snapshot of the drawn points in the background, the
+// morph itself starts once it is done. A morph in flight is picked up
+// from wherever it is by the next one, requests made while a job is
+// running are dropped.
 void
-acc_scale_v2f (Vec2f *dst, Vec2f s, Vec2f x, Vec2f y)
+start_morph_job (void)
 {
-  dst->x += s.x * x.x + s.y * y.x;
-  dst->y += s.x * x.y + s.y * y.y;
+  if (morph.is_job_running)
+    return;
+
+  reset_arena (&morph.arena);
+
+  morph.points = allocate_arrayf (&morph.arena, 3, context.points.count);
+  memcpy (morph.points.data,
+          context.points.data,
+          get_size_of_arrayf (&context.points));
+  morph.points.count = context.points.count;
+  morph.use_auto_degree = context.use_auto_degree;
+  morph.fit_norm = context.fit_norm;
+
+  atomic_store (&morph.is_job_done, false);
+
+  // Replays need the job to be done at a known frame, so they run it
+  // inline and it is picked up next frame.
+  if (replay.is_enabled)
+    run_morph_job (NULL);
+  else
+    run_on_task_thread (&morph.worker, run_morph_job, NULL);
+
+  morph.is_job_running = true;
 }
 
-Vec2f
-integrant (float *z, float angle)
+void
+interpolate_coeffs (Arrayf *dst, const Arrayf *from, const Arrayf *to,
+                    MorphKind kind, float w)
 {
-  float x = z[0], y = z[1];
-  float c = cos (angle), s = sin (angle);
+  size_t const count = from->count > to->count ? from->count : to->count;
+
+  // Missing frequencies of the smaller chain are zero, which is easy
+  // since chains of any degree share the same prefix layout.
+  for (size_t i = 0; i < count; i++)
+    {
+      float ax = 0, ay = 0, bx = 0, by = 0;
+
+      if (i < from->count)
+        {
+          ax = from->data[2 * i + 0];
+          ay = from->data[2 * i + 1];
+        }
+
+      if (i < to->count)
+        {
+          bx = to->data[2 * i + 0];
+          by = to->data[2 * i + 1];
+        }
+
+      float *const next = dst->data + 2 * i;
 
-  // Compute "z * e^(-i * angle)".
-  return (Vec2f){ x * c + y * s, y * c - x * s };
+      if (kind == MORPH_POLAR)
+        {
+          float const a_mag = hypot (ax, ay), b_mag = hypot (bx, by);
+          float const a_arg = a_mag > 0 ? atan2 (ay, ax) : atan2 (by, bx);
+          float const b_arg = b_mag > 0 ? atan2 (by, bx) : a_arg;
+
+          // Take the shorter way around.
+          float diff = fmod (b_arg - a_arg, 2 * M_PI);
+          diff = diff > M_PI ? diff - 2 * M_PI
+                             : (diff < -M_PI ? diff + 2 * M_PI : diff);
+
+          float const mag = a_mag + w * (b_mag - a_mag);
+          float const arg = a_arg + w * diff;
+
+          next[0] = mag * cos (arg);
+          next[1] = mag * sin (arg);
+        }
+      else
+        {
+          next[0] = ax + w * (bx - ax);
+          next[1] = ay + w * (by - ay);
+        }
+    }
+
+  dst->count = count;
 }
 
+// Picks up a finished job and advances the morph, leaving the blended
+// chain in "context.coeffs".
 void
-compute_fourier_series (float *dst, float *z, size_t count,
-                        uint32_t degree)
+update_morph (float time)
 {
-  assert (count % 2 == 1);
+  if (morph.is_job_running && atomic_load (&morph.is_job_done))
+    {
+      wait_for_task_thread (&morph.worker);
+
+      morph.is_job_running = false;
+      add_timing (&timings.transform, morph.job_seconds);
 
-  --count;
+      memcpy (morph.source.data,
+              context.coeffs.data,
+              get_size_of_arrayf (&context.coeffs));
+      morph.source.count = context.coeffs.count;
 
-  float const dt = 2.0 * M_PI / count;
-  float const factor = (1.0 / 3.0) / count;
+      // The job writes into its own array, so the target does not
+      // change under a morph that was still running.
+      memcpy (morph.target.data,
+              morph.result.data,
+              get_size_of_arrayf (&morph.result));
+      morph.target.count = morph.result.count;
 
-  for (int32_t i = -(int32_t)degree; i <= (int32_t)degree; i++)
+      morph.start_time = time;
+      morph.is_morphing = true;
+    }
+
+  if (!morph.is_morphing)
+    return;
+
+  float w = (time - morph.start_time) / MORPH_DURATION;
+
+  if (w >= 1)
+    {
+      memcpy (context.coeffs.data,
+              morph.target.data,
+              get_size_of_arrayf (&morph.target));
+      context.coeffs.count = morph.target.count;
+
+      morph.is_morphing = false;
+      context.is_trace_cache_ready = false;
+      ++context.coeffs_version;
+      context.is_full_curve_drawn = false;
+      context.should_clear_trace = true;
+    }
+  else
     {
-      Vec2f coeff = { 0, 0 };
+      w = w * w * (3 - 2 * w);
 
-      acc_scale_v2f (&coeff,
-                     (Vec2f){ factor, -factor },
-                     integrant (z + 0, 0),
-                     integrant (z + 3 * count, i * dt * count));
+      interpolate_coeffs (&context.coeffs,
+                          &morph.source,
+                          &morph.target,
+                          context.morph_kind,
+                          w);
+    }
+
+  context.circles.count = context.coeffs.count;
+  compute_circle_radii (&context.circles, &context.coeffs);
+}
+
+// Advances the morph and places the chain at "time", everything a
+// frame does besides drawing.
+void
+update_chain (float time)
+{
+  double const start = get_seconds ();
 
-      for (size_t j = 1; j < count; j += 2)
+  float const t = time - context.start_time;
+
+  update_morph (time);
+
+  Arrayf *const circles = &context.circles;
+
+  // The cache only holds the chain the morph ends with.
+  if (context.use_trace_cache && !morph.is_morphing)
+    {
+      if (!context.is_trace_cache_ready)
         {
-          acc_scale_v2f (&coeff,
-                         (Vec2f){ 4 * factor, 2 * factor },
-                         integrant (z + 3 * j, i * dt * j),
-                         integrant (z + 3 * (j + 1), i * dt * (j + 1)));
+          compute_trace_cache (&context.trace_cache,
+                               &context.coeffs);
+          context.is_trace_cache_ready = true;
         }
 
-      size_t ind = 2 * (i + degree);
-      dst[ind + 0] = coeff.x;
-      dst[ind + 1] = coeff.y;
+      sample_trace_cache (circles, &context.trace_cache, t);
     }
+  else
+    evaluate_chain (circles->data, 3, &context.coeffs, t);
+
+  context.line_trace[0] = context.line_trace[2];
+  context.line_trace[1] = context.line_trace[3];
+
+  size_t const i = circles->count - 1;
+
+  context.line_trace[2] = circles->data[3 * i + 0];
+  context.line_trace[3] = circles->data[3 * i + 1];
+
+  add_timing (&timings.chain, get_seconds () - start);
 }
 
 void
@@ -192,44 +563,58 @@ keyboard_callback (GLFWwindow *win,
   (void)scancode;
   (void)mods;
 
+  record_event ("key %d %d", key, action);
+
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-    glfwSetWindowShouldClose (win, true);
+    {
+      if (replay.is_enabled)
+        replay.should_close = true;
+      else
+        glfwSetWindowShouldClose (win, true);
+    }
+  else if (key == GLFW_KEY_A && action == GLFW_PRESS)
+    context.use_auto_degree = !context.use_auto_degree;
+  else if (key == GLFW_KEY_R && action == GLFW_PRESS)
+    context.fit_norm = context.fit_norm == FIT_MAX ? FIT_RMS : FIT_MAX;
+  else if (key == GLFW_KEY_C && action == GLFW_PRESS)
+    {
+      context.use_trace_cache = !context.use_trace_cache;
+      context.is_full_curve_drawn = false;
+    }
+  else if (key == GLFW_KEY_I && action == GLFW_PRESS)
+    context.morph_kind = context.morph_kind == MORPH_LINEAR
+                         ? MORPH_POLAR : MORPH_LINEAR;
+  else if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    context.use_morph = !context.use_morph;
+  else if (key == GLFW_KEY_N && action == GLFW_PRESS)
+    {
+      // Only the drawing is cleared, the chain keeps running so that
+      // the next one can morph from it.
+      context.points.count = 0;
+    }
   else if (key == GLFW_KEY_F && action == GLFW_PRESS)
     {
-      size_t const count = context.points.count;
-
-      if (count < 3)
+      if (context.points.count < 3)
         return;
 
-      bool should_incr = false;
-
-      if (count % 2 == 0)
+      if (context.use_morph && context.is_fourier_series_ready)
         {
-          float *const points = context.points.data;
-
-          points[count + 0] = (points[0] + points[count - 2]) / 2;
-          points[count + 1] = (points[1] + points[count - 1]) / 2;
-
-          should_incr = true;
+          start_morph_job ();
+          return;
         }
 
-      compute_fourier_series (context.coeffs.data,
-                              context.points.data,
-                              count + should_incr,
-                              FOURIER_DEGREE);
+      double const start = get_seconds ();
 
-      {
-        size_t ind = 2 * FOURIER_DEGREE;
-        float x = context.coeffs.data[ind + 0];
-        float y = context.coeffs.data[ind + 1];
+      reset_arena (&context.transform_arena);
+      transform_points (&context.transform_arena,
+                        &context.coeffs,
+                        &context.points,
+                        context.use_auto_degree,
+                        context.fit_norm);
 
-        memmove (context.coeffs.data + 2,
-                 context.coeffs.data,
-                 FOURIER_DEGREE * 2 * sizeof (float));
+      add_timing (&timings.transform, get_seconds () - start);
 
-        context.coeffs.data[0] = x;
-        context.coeffs.data[1] = y;
-      }
+      context.circles.count = context.coeffs.count;
 
       context.line_trace[2] = 0;
       context.line_trace[3] = 0;
@@ -240,17 +625,23 @@ keyboard_callback (GLFWwindow *win,
           context.line_trace[3] += context.coeffs.data[2 * i + 1];
         }
 
-      context.start_time = glfwGetTime ();
+      compute_circle_radii (&context.circles, &context.coeffs);
+
+      context.start_time = get_time ();
       context.is_fourier_series_ready = true;
+      ++context.coeffs_version;
+      context.is_trace_cache_ready = false;
+      context.is_full_curve_drawn = false;
+      context.should_clear_trace = true;
     }
 }
 
 gluint
-setup_circle_samples ()
+setup_circle_samples (Arena *scratch)
 {
   size_t const size_in_bytes = (CIRCLE_SAMPLES + 1)
                                * 2 * sizeof (float);
-  float *circle = malloc_or_exit (size_in_bytes);
+  float *circle = allocate_in_arena (scratch, size_in_bytes);
   float *next = circle;
 
   next[0] = 0;
@@ -273,8 +664,6 @@ setup_circle_samples ()
                 circle,
                 GL_STATIC_DRAW);
 
-  free (circle);
-
   return buffer;
 }
 
@@ -302,9 +691,401 @@ create_and_attach_buffer (gluint vertex_buffer,
   *buffer_loc = buffer;
 }
 
+void
+init_context (void)
+{
+  context.frame_arena = create_arena (FRAME_ARENA_SIZE);
+  context.transform_arena = create_arena (TRANSFORM_ARENA_SIZE);
+
+  context.points = create_arrayf (3, MAX_POINTS_COUNT);
+  context.coeffs = create_arrayf (2, 2 * MAX_FOURIER_DEGREE + 1);
+  context.circles = create_arrayf (3, 2 * MAX_FOURIER_DEGREE + 1);
+  context.trace_cache = create_arrayf (2 * (2 * MAX_FOURIER_DEGREE + 1),
+                                       TRACE_CACHE_SAMPLES);
+
+  context.is_fourier_series_ready = false;
+  context.use_trace_cache = false;
+  context.is_trace_cache_ready = false;
+  context.is_full_curve_drawn = false;
+  context.should_clear_trace = false;
+  context.use_auto_degree = false;
+  context.fit_norm = FIT_MAX;
+  context.use_morph = false;
+  context.morph_kind = MORPH_LINEAR;
+  context.coeffs_version = 0;
+
+  morph.arena = create_arena (TRANSFORM_ARENA_SIZE);
+  morph.result = create_arrayf (2, 2 * MAX_FOURIER_DEGREE + 1);
+  morph.source = create_arrayf (2, 2 * MAX_FOURIER_DEGREE + 1);
+  morph.target = create_arrayf (2, 2 * MAX_FOURIER_DEGREE + 1);
+
+  atomic_init (&morph.is_job_done, false);
+  morph.is_job_running = false;
+  morph.is_morphing = false;
+
+  for (size_t i = 1; i < TRACE_CACHE_THREADS; i++)
+    start_task_thread (context.trace_cache_threads + i - 1);
+
+  start_task_thread (&morph.worker);
+}
+
+void
+free_context (void)
+{
+  stop_task_thread (&morph.worker);
+
+  for (size_t i = 1; i < TRACE_CACHE_THREADS; i++)
+    stop_task_thread (context.trace_cache_threads + i - 1);
+
+  free (morph.target.data);
+  free (morph.source.data);
+  free (morph.result.data);
+  destroy_arena (&morph.arena);
+  destroy_arena (&context.transform_arena);
+  destroy_arena (&context.frame_arena);
+  free (context.trace_cache.data);
+  free (context.circles.data);
+  free (context.coeffs.data);
+  free (context.points.data);
+}
+
+void
+print_timings (void)
+{
+  const char *names[3] = { "transform", "chain", "upload" };
+  Timing const *all[3] = { &timings.transform,
+                           &timings.chain,
+                           &timings.upload };
+
+  for (size_t i = 0; i < 3; i++)
+    {
+      // Uploads only happen in the windowed loop, replays have no GL.
+      if (replay.is_enabled && all[i] == &timings.upload)
+        {
+          fprintf (stderr,
+                   "timing %s: not measured in replays\n",
+                   names[i]);
+          continue;
+        }
+
+      fprintf (stderr,
+               "timing %s: %zu calls, %.3f ms total, %.3f us mean\n",
+               names[i],
+               all[i]->calls,
+               all[i]->total * 1e3,
+               all[i]->calls > 0 ? all[i]->total * 1e6 / all[i]->calls
+                                 : 0.0);
+    }
+}
+
+// Tokens of "actual" and "expected" have to be equal, except numbers,
+// which may differ by "REPLAY_TOLERANCE", and hashes, which are only
+// informational since a coefficient near a rounding boundary flips
+// them. The coefficients are compared one by one instead.
+bool
+do_lines_match (char *actual, char *expected)
+{
+  char *actual_state, *expected_state;
+  char *a = strtok_r (actual, " ", &actual_state);
+  char *b = strtok_r (expected, " ", &expected_state);
+
+  while (a != NULL && b != NULL)
+    {
+      char *a_end, *b_end;
+      double const x = strtod (a, &a_end);
+      double const y = strtod (b, &b_end);
+
+      bool const are_numbers = a_end != a && *a_end == '\0'
+                               && b_end != b && *b_end == '\0';
+      bool const are_hashes = strncmp (a, "fnv:", 4) == 0
+                              && strncmp (b, "fnv:", 4) == 0;
+
+      if (are_numbers && fabs (x - y) > REPLAY_TOLERANCE)
+        return false;
+
+      if (!are_numbers && !are_hashes && strcmp (a, b) != 0)
+        return false;
+
+      a = strtok_r (NULL, " ", &actual_state);
+      b = strtok_r (NULL, " ", &expected_state);
+    }
+
+  return a == NULL && b == NULL;
+}
+
+// Prints one line of the replay report and checks it against the next
+// line of the golden report, if there is one.
+void
+report (const char *format, ...)
+{
+  char actual[256], expected[256];
+
+  va_list args;
+  va_start (args, format);
+  vsnprintf (actual, sizeof (actual), format, args);
+  va_end (args);
+
+  puts (actual);
+
+  if (replay.golden == NULL)
+    return;
+
+  if (fgets (expected, sizeof (expected), replay.golden) == NULL)
+    expected[0] = '\0';
+
+  expected[strcspn (expected, "\n")] = '\0';
+
+  char actual_tokens[256], expected_tokens[256];
+  strcpy (actual_tokens, actual);
+  strcpy (expected_tokens, expected);
+
+  if (!do_lines_match (actual_tokens, expected_tokens))
+    {
+      fprintf (stderr,
+               "MISMATCH:\n  expected: %s\n  actual:   %s\n",
+               expected,
+               actual);
+      ++replay.mismatches_count;
+    }
+}
+
+uint64_t
+hash_coeffs (const Arrayf *coeffs)
+{
+  uint64_t hash = 14695981039346656037ull;
+
+  for (size_t i = 0; i < 2 * coeffs->count; i++)
+    {
+      uint32_t const value = lround (coeffs->data[i] / COEFF_HASH_QUANTUM);
+
+      for (size_t j = 0; j < sizeof (value); j++)
+        {
+          hash ^= (value >> (8 * j)) & 0xff;
+          hash *= 1099511628211ull;
+        }
+    }
+
+  return hash;
+}
+
+void
+apply_event (const char *kind)
+{
+  bool is_ok = true;
+
+  if (strcmp (kind, "cursor") == 0)
+    {
+      double x, y;
+      is_ok = fscanf (replay.input, "%lf %lf", &x, &y) == 2;
+
+      if (is_ok)
+        mouse_cursor_pos_callback (NULL, x, y);
+    }
+  else if (strcmp (kind, "button") == 0)
+    {
+      int button, action;
+      is_ok = fscanf (replay.input, "%d %d", &button, &action) == 2;
+
+      if (is_ok)
+        mouse_button_callback (NULL, button, action, 0);
+    }
+  else if (strcmp (kind, "key") == 0)
+    {
+      int key, action;
+      is_ok = fscanf (replay.input, "%d %d", &key, &action) == 2;
+
+      if (is_ok)
+        keyboard_callback (NULL, key, 0, action, 0);
+    }
+  else if (strcmp (kind, "end") == 0)
+    replay.should_close = true;
+  else
+    is_ok = false;
+
+  if (!is_ok)
+    {
+      fprintf (stderr, "ERROR: malformed event \'%s\'.\n", kind);
+      exit (EXIT_FAILURE);
+    }
+}
+
+bool
+read_event (double *time, char *kind)
+{
+  return fscanf (replay.input, "%lf %15s", time, kind) == 2;
+}
+
+// Feeds recorded events to the callbacks at their times and reports
+// every new set of coefficients and, periodically, the tip of the
+// chain. Nothing is drawn, so no window or GL context is needed.
 int
-main (void)
+run_replay (const char *input_path, const char *golden_path)
 {
+  replay.input = fopen (input_path, "r");
+
+  if (replay.input == NULL)
+    {
+      fprintf (stderr, "ERROR: failed to open \'%s\'.\n", input_path);
+      exit (EXIT_FAILURE);
+    }
+
+  if (golden_path != NULL)
+    {
+      replay.golden = fopen (golden_path, "r");
+
+      if (replay.golden == NULL)
+        {
+          fprintf (stderr,
+                   "ERROR: failed to open \'%s\'.\n",
+                   golden_path);
+          exit (EXIT_FAILURE);
+        }
+    }
+
+  replay.is_enabled = true;
+  replay.should_close = false;
+  replay.mismatches_count = 0;
+
+  init_context ();
+
+  double event_time;
+  char kind[16];
+  bool has_event = read_event (&event_time, kind);
+
+  size_t reported_version = context.coeffs_version;
+
+#ifndef NDEBUG
+  size_t const allocation_count = get_allocation_count ();
+#endif
+
+  for (size_t frame = 0; !replay.should_close; frame++)
+    {
+      replay.time = frame * REPLAY_FRAME_TIME;
+
+      reset_arena (&context.frame_arena);
+
+      while (has_event && event_time <= replay.time)
+        {
+          apply_event (kind);
+          has_event = read_event (&event_time, kind);
+        }
+
+      if (context.is_fourier_series_ready)
+        {
+          update_chain (replay.time);
+
+          if (context.coeffs_version != reported_version)
+            {
+              Arrayf const *const coeffs = &context.coeffs;
+
+              report ("coeffs %zu %zu fnv:%016llx",
+                      frame,
+                      coeffs->count,
+                      (unsigned long long)hash_coeffs (coeffs));
+
+              for (size_t i = 0; i < coeffs->count; i++)
+                report ("coeff %zu %.6f %.6f",
+                        i,
+                        coeffs->data[2 * i + 0],
+                        coeffs->data[2 * i + 1]);
+
+              reported_version = context.coeffs_version;
+            }
+
+          if (frame % REPLAY_TIP_INTERVAL == 0)
+            {
+              size_t const i = context.circles.count - 1;
+
+              report ("tip %zu %.6f %.6f",
+                      frame,
+                      context.circles.data[3 * i + 0],
+                      context.circles.data[3 * i + 1]);
+            }
+        }
+
+      // Without an explicit end, stop once nothing is left to play.
+      if (!has_event && !morph.is_job_running && !morph.is_morphing)
+        replay.should_close = true;
+
+      assert (get_allocation_count () == allocation_count);
+    }
+
+  if (replay.golden != NULL)
+    {
+      char extra[256];
+
+      if (fgets (extra, sizeof (extra), replay.golden) != NULL)
+        {
+          fputs ("MISMATCH: golden report has more lines.\n", stderr);
+          ++replay.mismatches_count;
+        }
+
+      fclose (replay.golden);
+    }
+
+  fclose (replay.input);
+
+  print_timings ();
+  free_context ();
+
+  if (replay.mismatches_count > 0)
+    {
+      fprintf (stderr,
+               "%zu lines differ from \'%s\'.\n",
+               replay.mismatches_count,
+               golden_path);
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
+
+void
+print_usage (const char *program)
+{
+  fprintf (stderr,
+           "usage: %s [--record events] "
+           "| --replay events [--golden report]\n",
+           program);
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *record_path = NULL, *replay_path = NULL;
+  const char *golden_path = NULL;
+
+  for (int i = 1; i < argc; i++)
+    {
+      if (i + 1 < argc && strcmp (argv[i], "--record") == 0)
+        record_path = argv[++i];
+      else if (i + 1 < argc && strcmp (argv[i], "--replay") == 0)
+        replay_path = argv[++i];
+      else if (i + 1 < argc && strcmp (argv[i], "--golden") == 0)
+        golden_path = argv[++i];
+      else
+        {
+          print_usage (argv[0]);
+          exit (EXIT_FAILURE);
+        }
+    }
+
+  if (replay_path != NULL)
+    return run_replay (replay_path, golden_path);
+
+  if (record_path != NULL)
+    {
+      replay.record = fopen (record_path, "w");
+
+      if (replay.record == NULL)
+        {
+          fprintf (stderr,
+                   "ERROR: failed to open \'%s\'.\n",
+                   record_path);
+          exit (EXIT_FAILURE);
+        }
+    }
+
   if (!glfwInit ())
     exit (EXIT_FAILURE);
 
@@ -330,7 +1111,10 @@ main (void)
   glfwSetCursorPosCallback (window, mouse_cursor_pos_callback);
   glfwSetKeyCallback (window, keyboard_callback);
 
-  gluint circle_samples_buffer = setup_circle_samples ();
+  init_context ();
+
+  gluint circle_samples_buffer
+    = setup_circle_samples (&context.transform_arena);
 
   gluint points_array;
   create_and_attach_buffer (circle_samples_buffer,
@@ -342,15 +1126,6 @@ main (void)
                             &circle_array,
                             &circle_buffer);
 
-  context.points = create_arrayf (3, MAX_POINTS_COUNT + 1);
-  context.coeffs = create_arrayf (2, 2 * FOURIER_DEGREE + 1);
-  Arrayf circles = create_arrayf (3, 2 * FOURIER_DEGREE + 1);
-
-  // Remove last point for fourier series.
-  --context.points.capacity;
-  context.coeffs.count = context.coeffs.capacity;
-  circles.count = circles.capacity;
-
   glBindBuffer (GL_ARRAY_BUFFER, context.points_buffer);
   glBufferData (GL_ARRAY_BUFFER,
                 get_total_size_of_arrayf (&context.points),
@@ -359,7 +1134,7 @@ main (void)
 
   glBindBuffer (GL_ARRAY_BUFFER, circle_buffer);
   glBufferData (GL_ARRAY_BUFFER,
-                get_total_size_of_arrayf (&circles),
+                get_total_size_of_arrayf (&context.circles),
                 NULL,
                 GL_DYNAMIC_DRAW);
 
@@ -378,6 +1153,21 @@ main (void)
   glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
   glEnableVertexAttribArray (0);
 
+  gluint curve_array, curve_buffer;
+  glCreateVertexArrays (1, &curve_array);
+  glCreateBuffers (1, &curve_buffer);
+
+  glBindBuffer (GL_ARRAY_BUFFER, curve_buffer);
+  glBufferData (GL_ARRAY_BUFFER,
+                TRACE_CACHE_SAMPLES * 2 * sizeof (float),
+                NULL,
+                GL_DYNAMIC_DRAW);
+
+  glBindVertexArray (curve_array);
+  glBindBuffer (GL_ARRAY_BUFFER, curve_buffer);
+  glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
+  glEnableVertexAttribArray (0);
+
   gluint connecting_lines_array;
   glCreateVertexArrays (1, &connecting_lines_array);
 
@@ -394,31 +1184,46 @@ main (void)
   gluint circle_program, primitive_program, texture_program;
 
   {
+    Arena *const scratch = &context.transform_arena;
+
     gluint vertex_shader
-      = create_shader (GL_VERTEX_SHADER, "shaders/circle.vert");
+      = create_shader (scratch,
+                       GL_VERTEX_SHADER,
+                       "shaders/circle.vert");
     gluint fragment_shader
-      = create_shader (GL_FRAGMENT_SHADER, "shaders/circle.frag");
-    circle_program = create_program (vertex_shader, fragment_shader);
+      = create_shader (scratch,
+                       GL_FRAGMENT_SHADER,
+                       "shaders/circle.frag");
+    circle_program
+      = create_program (scratch, vertex_shader, fragment_shader);
 
     glDeleteShader (vertex_shader);
     glDeleteShader (fragment_shader);
 
     vertex_shader
-      = create_shader (GL_VERTEX_SHADER, "shaders/primitive.vert");
+      = create_shader (scratch,
+                       GL_VERTEX_SHADER,
+                       "shaders/primitive.vert");
     fragment_shader
-      = create_shader (GL_FRAGMENT_SHADER, "shaders/primitive.frag");
+      = create_shader (scratch,
+                       GL_FRAGMENT_SHADER,
+                       "shaders/primitive.frag");
     primitive_program
-      = create_program (vertex_shader, fragment_shader);
+      = create_program (scratch, vertex_shader, fragment_shader);
 
     glDeleteShader (vertex_shader);
     glDeleteShader (fragment_shader);
 
     vertex_shader
-      = create_shader (GL_VERTEX_SHADER, "shaders/texture.vert");
+      = create_shader (scratch,
+                       GL_VERTEX_SHADER,
+                       "shaders/texture.vert");
     fragment_shader
-      = create_shader (GL_FRAGMENT_SHADER, "shaders/texture.frag");
+      = create_shader (scratch,
+                       GL_FRAGMENT_SHADER,
+                       "shaders/texture.frag");
     texture_program
-      = create_program (vertex_shader, fragment_shader);
+      = create_program (scratch, vertex_shader, fragment_shader);
 
     glDeleteShader (vertex_shader);
     glDeleteShader (fragment_shader);
@@ -510,8 +1315,6 @@ main (void)
       exit (EXIT_FAILURE);
     }
 
-  context.is_fourier_series_ready = false;
-
   glEnable (GL_BLEND);
   glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -520,56 +1323,46 @@ main (void)
   glClear (GL_COLOR_BUFFER_BIT);
   glClearColor (1.0, 0.0, 0.0, 1.0);
 
+  reset_arena (&context.transform_arena);
+
+#ifndef NDEBUG
+  // Everything past this point runs on arenas and preallocated arrays.
+  size_t const allocation_count = get_allocation_count ();
+#endif
+
   while (!glfwWindowShouldClose (window))
     {
+      reset_arena (&context.frame_arena);
+
       if (context.is_fourier_series_ready)
         {
-          float const t = glfwGetTime () - context.start_time;
-
-          circles.data[0] = context.coeffs.data[0];
-          circles.data[1] = context.coeffs.data[1];
-
-          int freq = -FOURIER_DEGREE;
-
-          size_t i = 1;
-          while (i < context.coeffs.count)
-            {
-              freq += (freq == 0);
-
-              float c = cos (freq * t), s = sin (freq * t);
-              float x = context.coeffs.data[2 * i + 0];
-              float y = context.coeffs.data[2 * i + 1];
+          update_chain (get_time ());
 
-              size_t const ind = 3 * i;
-              circles.data[ind - 1] = sqrt (x * x + y * y);
-              circles.data[ind + 0] = x * c - y * s
-                                      + circles.data[ind - 3];
-              circles.data[ind + 1] = x * s + y * c
-                                      + circles.data[ind - 2];
-
-              ++freq;
-              ++i;
-            }
-
-          context.line_trace[0] = context.line_trace[2];
-          context.line_trace[1] = context.line_trace[3];
-
-          --i;
-
-          context.line_trace[2] = circles.data[3 * i + 0];
-          context.line_trace[3] = circles.data[3 * i + 1];
+          double const start = get_seconds ();
 
           glBindBuffer (GL_ARRAY_BUFFER, circle_buffer);
           glBufferSubData (GL_ARRAY_BUFFER,
                            0,
-                           get_size_of_arrayf (&circles),
-                           circles.data);
+                           get_size_of_arrayf (&context.circles),
+                           context.circles.data);
 
           glBindBuffer (GL_ARRAY_BUFFER, trace_buffer);
           glBufferSubData (GL_ARRAY_BUFFER,
                            0,
                            sizeof (context.line_trace),
                            context.line_trace);
+
+          add_timing (&timings.upload, get_seconds () - start);
+        }
+
+      if (context.should_clear_trace)
+        {
+          glClearColor (0.0, 0.0, 0.0, 0.0);
+          glBindFramebuffer (GL_FRAMEBUFFER, trace_framebuffer);
+          glClear (GL_COLOR_BUFFER_BIT);
+          glClearColor (1.0, 0.0, 0.0, 1.0);
+
+          context.should_clear_trace = false;
         }
 
       glBindFramebuffer (GL_FRAMEBUFFER, 0);
@@ -593,7 +1386,7 @@ main (void)
           glDrawArraysInstanced (GL_LINE_LOOP,
                                  1,
                                  CIRCLE_SAMPLES,
-                                 circles.count - 1);
+                                 context.circles.count - 1);
 
           glUseProgram (texture_program);
           glBindVertexArray (texture_array);
@@ -601,22 +1394,67 @@ main (void)
 
           glUseProgram (primitive_program);
           glBindVertexArray (connecting_lines_array);
-          glDrawArrays (GL_LINE_STRIP, 0, circles.count);
+          glDrawArrays (GL_LINE_STRIP, 0, context.circles.count);
 
           glBindFramebuffer (GL_FRAMEBUFFER, trace_framebuffer);
 
-          glBindVertexArray (trace_array);
-          glDrawArrays (GL_LINES, 0, 2);
+          // The chains in between are not traced, the curve is
+          // cleared and traced anew once the morph is done.
+          bool const is_tracing = !morph.is_morphing;
+
+          if (is_tracing && !context.use_trace_cache)
+            {
+              glBindVertexArray (trace_array);
+              glDrawArrays (GL_LINES, 0, 2);
+            }
+          else if (is_tracing && !context.is_full_curve_drawn)
+            {
+              // The whole period is known, so the final curve is
+              // traced at once instead of segment by segment.
+              Arrayf const *const cache = &context.trace_cache;
+              size_t const tip = 2 * (context.circles.count - 1);
+
+              Arrayf curve = allocate_arrayf (&context.frame_arena,
+                                              2,
+                                              cache->count);
+              curve.count = cache->count;
+
+              for (size_t i = 0; i < cache->count; i++)
+                {
+                  curve.data[2 * i + 0]
+                    = cache->data[cache->comps * i + tip + 0];
+                  curve.data[2 * i + 1]
+                    = cache->data[cache->comps * i + tip + 1];
+                }
+
+              glBindBuffer (GL_ARRAY_BUFFER, curve_buffer);
+              glBufferSubData (GL_ARRAY_BUFFER,
+                               0,
+                               get_size_of_arrayf (&curve),
+                               curve.data);
+
+              glBindVertexArray (curve_array);
+              glDrawArrays (GL_LINE_LOOP, 0, curve.count);
+
+              context.is_full_curve_drawn = true;
+            }
         }
 
       glfwSwapBuffers (window);
 
       glfwPollEvents ();
+
+      assert (get_allocation_count () == allocation_count);
     }
 
-  free (circles.data);
-  free (context.coeffs.data);
-  free (context.points.data);
+  free_context ();
+
+  if (replay.record != NULL)
+    {
+      record_event ("end");
+      fclose (replay.record);
+      print_timings ();
+    }
 
   glfwTerminate ();
 
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Replays every recorded session in this directory against its golden
+# report, run after build.sh from the repository root. A report is
+# regenerated with "./a.out --replay tests/X.events > tests/X.golden".
+# Replays also print transform and chain timings to stderr. Uploads are
+# only timed in the windowed loop, since replays run without GL.
+
+set -u
+
+cd "$(dirname "$0")/.."
+
+status=0
+
+for events in tests/*.events; do
+  golden="${events%.events}.golden"
+
+  if ./a.out --replay "${events}" --golden "${golden}" > /dev/null; then
+    echo "PASS ${events}"
+  else
+    echo "FAIL ${events}"
+    status=1
+  fi
+done
+
+exit ${status}